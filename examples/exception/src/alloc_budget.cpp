@@ -0,0 +1,172 @@
+#ifndef TEST_ALLOC_BUDGET_HPP
+#define TEST_ALLOC_BUDGET_HPP
+
+
+#include <iostream>
+#include <streambuf>
+
+#define PROSTO_ALLOC_COUNTER_DEFINE_HOOKS
+#include <prosto/exception/alloc_counter.hpp>
+
+#include "all.hpp"
+#include "my_exception.hpp"
+
+
+namespace {
+
+// every info entry costs a map node, the error_info and its shared_ptr block.
+#ifdef PROSTO_PSEUDO_DEBUG
+std::size_t const debug_ = 9;  // linenumber, filename and function
+#else
+std::size_t const debug_ = 0;
+#endif
+
+
+// swallows everything, so printing is measured without the cost of a real sink.
+class null_buffer : public std::streambuf {
+protected:
+  int_type overflow(int_type c) { return traits_type::not_eof(c); }
+  std::streamsize xsputn(char const*, std::streamsize n) { return n; }
+};
+
+
+bool report(char const* name, prosto::alloc_counter::counts const& d, std::size_t budget) {
+  bool ok = d.allocations <= budget;
+
+  std::cerr << (ok ? "within budget\t:\t" : "over budget\t:\t") << name
+            << " (" << d.allocations << " of " << budget << " allocations, "
+            << d.bytes << " bytes)\n";
+  return ok;
+}
+
+
+bool within(char const* name, prosto::alloc_counter::scope const& s, std::size_t budget) {
+  return report(name, s.delta(), budget);
+}
+
+
+// runs one of the example cases with std::cerr muted.
+bool case_within(char const* name, bool (*fn)(), std::size_t budget) {
+  null_buffer nb;
+  std::streambuf* old = std::cerr.rdbuf(&nb);
+
+  prosto::alloc_counter::scope s;
+  bool res = fn();
+  auto d = s.delta();
+
+  std::cerr.rdbuf(old);
+
+  return report(name, d, budget) && res;
+}
+
+
+// construct, throw, catch, read and print step by step.
+template<typename make_T>
+bool phases_within(char const* name, make_T make
+                  ,std::size_t construct, std::size_t throw_catch
+                  ,std::size_t read, std::size_t print) {
+  using namespace prosto;
+
+  null_buffer nb;
+  std::ostream null_os(&nb);
+  bool ok = true;
+
+  std::cerr << name << "\n";
+
+  alloc_counter::scope s;
+  auto e = make();
+  ok = within("\tconstruct", s, construct) && ok;
+
+  s.reset();
+  try { throw(e); }
+  catch(std::exception const& c) {
+    ok = within("\tthrow and catch", s, throw_catch) && ok;
+
+    s.reset();
+    bool found = exception::info<exception::code>(c)
+              && exception::info<exception::message>(c)
+              && c.what();
+    ok = within("\tinfo", s, read) && found && ok;
+
+    s.reset();
+    null_os << c;
+    ok = within("\tprint", s, print) && ok;
+  }
+
+  return ok;
+}
+
+
+#if defined(__cpp_aligned_new)
+struct alignas(64) over_aligned { char c[64]; };
+#endif
+
+
+// the budgets are meaningless if the hooks are not linked in.
+bool hooks_counting() {
+  bool ok = true;
+
+  prosto::alloc_counter::scope s;
+  delete new int(0);
+  ok = s.delta().allocations == 1 && s.delta().deallocations == 1 && ok;
+
+#if defined(__cpp_aligned_new)
+  s.reset();
+  delete new over_aligned();
+  ok = s.delta().allocations == 1 && s.delta().deallocations == 1 && ok;
+#endif
+
+  std::cerr << (ok ? "hooks counting\n" : "hooks not counting\n");
+  return ok;
+}
+
+
+bool alloc_budget_phases() {
+  bool ok = true;
+
+  ok = phases_within("prosto_error", [] {
+    return prosto_error(0x1, "throw prosto error");
+  }, 9 + debug_, 0, 0, 0) && ok;
+
+  ok = phases_within("custom prosto error", [] {
+    return my_exception(prosto_error(0x3
+                                    ,"throw custom prosto error"
+                                    ,my_exception::my_type(12.345)));
+  }, 15 + debug_, 0, 0, 0) && ok;
+
+  return ok;
+}
+
+
+bool alloc_budget_cases() {
+  bool ok = true;
+
+  ok = case_within("throw std catch std first",     throw_std_catch_std_first,     1) && ok;
+  ok = case_within("throw std catch prosto first",  throw_std_catch_prosto_first,  1) && ok;
+  ok = case_within("throw prosto catch std first",  throw_prosto_catch_std_first,  9 + debug_) && ok;
+  ok = case_within("throw prosto catch prosto first", throw_prosto_catch_prosto_first, 9 + debug_) && ok;
+
+  ok = case_within("throw prosto exception",        throw_prosto_exception,        9) && ok;
+  ok = case_within("throw prosto error",            throw_prosto_error,            9 + debug_) && ok;
+  ok = case_within("throw custom prosto exception", throw_custom_prosto_exception, 15) && ok;
+  ok = case_within("throw custom prosto error",     throw_custom_prosto_error,     15 + debug_) && ok;
+  ok = case_within("throw nested test",             throw_nested_test,             23 + 2 * debug_) && ok;
+  ok = case_within("throw prosto exception with std::string", throw_prosto_exception_with_stdstring, 9 + debug_) && ok;
+  ok = case_within("throw prosto exception without code", throw_prosto_exception_without_code, 6 + debug_) && ok;
+  ok = case_within("throw prosto exception into stringstream", throw_prosto_exception_into_stringstream, 11 + debug_) && ok;
+
+  return ok;
+}
+
+} // namespace
+
+
+int main() {
+  bool ok = hooks_counting();
+  ok = alloc_budget_phases() && ok;
+  ok = alloc_budget_cases() && ok;
+
+  return ok ? 0 : 1;
+}
+
+#endif // TEST_ALLOC_BUDGET_HPP
@@ -0,0 +1,186 @@
+#ifndef TEST_REPORTER_HPP
+#define TEST_REPORTER_HPP
+
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#define PROSTO_ALLOC_COUNTER_DEFINE_HOOKS
+#include <prosto/exception/alloc_counter.hpp>
+#include <prosto/exception/reporter.hpp>
+
+
+namespace {
+
+std::size_t count(std::string const& s, std::string const& what) {
+  std::size_t n = 0;
+  for(auto p = s.find(what); p != std::string::npos; p = s.find(what, p + 1))
+    n++;
+  return n;
+}
+
+
+void throw_same() {
+  throw(prosto_error(0x10, "failing dependency"));
+}
+
+void throw_nested_same() {
+  try { throw_same(); }
+  catch(std::exception const&) {
+    std::throw_with_nested(prosto_error(0x11, "request failed"));
+  }
+}
+
+
+bool report_duplicates() {
+  std::stringstream ss;
+  prosto::reporter rep(ss, std::chrono::hours(1));
+  unsigned int printed = 0;
+
+  for(int i = 0; i < 1000; i++) {
+    try { throw_same(); }
+    catch(std::exception const& e) {
+      if(rep.report(e))
+        printed++;
+    }
+  }
+
+  rep.flush();
+
+  std::cerr << ss.str();
+  return printed == 1
+      && count(ss.str(), "failing dependency") == 1
+      && count(ss.str(), "suppressed 999 times") == 1;
+}
+
+
+bool report_nested_separately() {
+  std::stringstream ss;
+  prosto::reporter rep(ss, std::chrono::hours(1));
+  bool ok = true;
+
+  for(int i = 0; i < 3; i++) {
+    try { throw_same(); }
+    catch(std::exception const& e) { ok = rep.report(e) == (i == 0) && ok; }
+
+    try { throw_nested_same(); }
+    catch(std::exception const& e) { ok = rep.report(e) == (i == 0) && ok; }
+  }
+
+  rep.flush();
+
+  std::cerr << ss.str();
+  return ok && count(ss.str(), "suppressed 2 times") == 2;
+}
+
+
+bool report_suppressed_without_allocation() {
+  std::stringstream ss;
+  prosto::reporter rep(ss, std::chrono::hours(1));
+  prosto::exception e = prosto_error(0x12, "suppressed without allocation");
+
+  rep.report(e);
+
+  // zero allocations only mean something if the hooks count at all.
+  prosto::alloc_counter::scope s;
+  delete new int(0);
+  bool counting = s.delta().allocations == 1;
+
+  s.reset();
+  bool suppressed = !rep.report(e) && !rep.report(e);
+  auto d = s.delta();
+
+  std::cerr << "suppressed reports\t:\t" << d.allocations << " allocations\n";
+  return counting && suppressed && d.allocations == 0;
+}
+
+
+bool report_overflow_rate_limited() {
+  std::stringstream ss;
+  prosto::reporter rep(ss, std::chrono::hours(1), 1, 4);
+  unsigned int printed = 0;
+
+  // every code and message is different, like messages carrying ids.
+  for(unsigned int i = 0; i < 100; i++) {
+    if(rep.report(prosto_error(0x1300 + i, "request " + std::to_string(i) + " failed")))
+      printed++;
+  }
+
+  rep.flush();
+
+  // four slots and one full print for the overflow bucket.
+  std::cerr << ss.str();
+  return printed == 5
+      && count(ss.str(), "unclassified\t:\tsuppressed 95 times") == 1;
+}
+
+
+bool report_refilled_after_interval() {
+  std::stringstream ss;
+  prosto::reporter rep(ss, std::chrono::milliseconds(20));
+  prosto::exception e = prosto_error(0x14, "refilled after interval");
+  bool ok = true;
+
+  ok = rep.report(e) && ok;
+  ok = !rep.report(e) && ok;
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(40));
+
+  // the first suppression after the interval emits the summary and refills.
+  ok = !rep.report(e) && ok;
+  ok = rep.report(e) && ok;
+
+  std::cerr << ss.str();
+  return ok
+      && count(ss.str(), "suppressed 2 times") == 1
+      && count(ss.str(), "refilled after interval") == 2;
+}
+
+
+bool report_reclaimed_after_idle() {
+  std::stringstream ss;
+  prosto::reporter rep(ss, std::chrono::milliseconds(20), 1, 4);
+  prosto::exception fresh = prosto_error(0x15, "new failure");
+
+  // fill the table, the new failure only finds the overflow bucket.
+  for(unsigned int i = 0; i < 4; i++)
+    rep.report(prosto_error(0x1500 + i, "old failure"));
+
+  rep.report(fresh);
+  rep.report(fresh);
+  rep.flush();
+
+  // a whole interval without any report of the old failures.
+  std::this_thread::sleep_for(std::chrono::milliseconds(40));
+  rep.flush();
+
+  rep.report(fresh);
+  rep.report(fresh);
+  rep.flush();
+
+  std::stringstream own;
+  own << "fingerprint\t:\t0x" << std::hex << std::uppercase
+      << prosto::reporter::fingerprint(fresh) << " suppressed 1 times";
+
+  std::cerr << ss.str();
+  return count(ss.str(), "unclassified\t:\tsuppressed 1 times") == 1
+      && count(ss.str(), own.str()) == 1;
+}
+
+} // namespace
+
+
+int main() {
+  bool ok = report_duplicates();
+  ok = report_nested_separately() && ok;
+  ok = report_suppressed_without_allocation() && ok;
+  ok = report_overflow_rate_limited() && ok;
+  ok = report_refilled_after_interval() && ok;
+  ok = report_reclaimed_after_idle() && ok;
+
+  return ok ? 0 : 1;
+}
+
+#endif // TEST_REPORTER_HPP
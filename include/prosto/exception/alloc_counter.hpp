@@ -0,0 +1,275 @@
+/* ************************************************************************* *\
+ * This file is part of prosto-lib.                                          *
+ *                                                                           *
+ * This library is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU Lesser General Public License as published by  *
+ * the Free Software Foundation; either version 2.1 of the License.          *
+ *                                                                           *
+ * This library is distributed in the hope that it will be useful, but       *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser   *
+ * General Public License for more details.                                  *
+ *                                                                           *
+ * You should have received a copy of the GNU Lesser General Public License  *
+ * along with this library (see the file LICENCE); If not, see               *
+ * <http://www.gnu.org/licenses/old-licenses/lgpl-2.1.en.html>.              *
+\* ************************************************************************* */
+
+/*!
+ * \file   alloc_counter.hpp
+ * \author michail peterlis
+ * \brief  Counting hooks for the global operator new and operator delete.
+ * ************************************************************************* */
+
+
+#ifndef PROSTO_EXCEPTION_ALLOC_COUNTER_HPP
+#define PROSTO_EXCEPTION_ALLOC_COUNTER_HPP
+
+#include <cstddef>
+
+
+namespace prosto {
+
+//! \example alloc_budget.cpp
+
+/*! \brief Heap traffic instrumentation.
+ *
+ * The counters are only fed if the replacement operators are compiled into the
+ * program. To do so, define \b PROSTO_ALLOC_COUNTER_DEFINE_HOOKS in exactly one
+ * translation unit before including this header. Every other translation unit
+ * simply includes the header to read the counters.
+ *
+ * <h2>Short usage</h2>
+ * \code
+ * // in exactly one .cpp of the program
+ * #define PROSTO_ALLOC_COUNTER_DEFINE_HOOKS
+ * #include <prosto/exception/alloc_counter.hpp>
+ * // ...
+ *
+ * prosto::alloc_counter::scope s;
+ * throw_something();
+ * if(s.delta().allocations > 4)
+ *   std::cerr << "budget exceeded" << std::endl;
+ * \endcode
+ *
+ * \note
+ * The counters are kept per thread, so a scope only sees the heap traffic of
+ * the thread it lives in. Memory freed by another thread is counted there.
+ *
+ * \note
+ * Memory obtained by the runtime for the thrown object itself (__cxa_allocate_exception)
+ * does not go through operator new and is therefore not counted.
+ */
+namespace alloc_counter {
+
+//! Snapshot of the counters of the calling thread.
+struct counts {
+  std::size_t allocations;
+  std::size_t deallocations;
+  std::size_t bytes;
+};
+
+
+namespace detail_ {
+
+inline counts& current() noexcept {
+  static thread_local counts c = {0, 0, 0};
+  return c;
+}
+
+} // namespace detail_
+
+
+//! Returns the counters of the calling thread.
+inline counts snapshot() noexcept {
+  return detail_::current();
+}
+
+//! Records an allocation of \a n bytes. Called by the replacement operators.
+inline void on_allocate(std::size_t n) noexcept {
+  counts& c = detail_::current();
+  ++c.allocations;
+  c.bytes += n;
+}
+
+//! Records a deallocation. Called by the replacement operators.
+inline void on_deallocate() noexcept {
+  ++detail_::current().deallocations;
+}
+
+
+/*! \brief Measures the heap traffic between its construction and delta().
+ *
+ * A scope can be asked more than once, each call returning the traffic since
+ * construction or the last reset().
+ */
+class scope {
+public:
+  scope() noexcept : start_(snapshot()) {}
+
+  //! Returns the heap traffic of this thread since construction or reset().
+  counts delta() const noexcept {
+    counts now = snapshot();
+    counts d = { now.allocations   - start_.allocations
+               , now.deallocations - start_.deallocations
+               , now.bytes         - start_.bytes };
+    return d;
+  }
+
+  //! Restarts the measurement.
+  void reset() noexcept { start_ = snapshot(); }
+
+private:
+  counts start_;
+};
+
+} // namespace alloc_counter
+} // namespace prosto
+
+#endif // PROSTO_EXCEPTION_ALLOC_COUNTER_HPP
+
+
+// The replacement operators are kept outside the include guard, so the defining
+// translation unit gets them even if the header was already included before.
+#if defined(PROSTO_ALLOC_COUNTER_DEFINE_HOOKS) && !defined(PROSTO_ALLOC_COUNTER_HOOKS_DEFINED)
+#define PROSTO_ALLOC_COUNTER_HOOKS_DEFINED
+
+#include <cstdlib>
+#include <new>
+
+// ::aligned_alloc (C11) instead of std::aligned_alloc, since __cpp_aligned_new
+// is also set by -faligned-new in C++11 and C++14.
+#include <stdlib.h>
+
+
+namespace prosto {
+namespace alloc_counter {
+namespace detail_ {
+
+inline void* allocate(std::size_t n) {
+  for(;;) {
+    if(void* p = std::malloc(n ? n : 1)) {
+      on_allocate(n);
+      return p;
+    }
+
+    std::new_handler h = std::get_new_handler();
+    if(!h)
+      throw std::bad_alloc();
+    h();
+  }
+}
+
+inline void* allocate(std::size_t n, std::nothrow_t const&) noexcept {
+  try { return allocate(n); }
+  catch(...) { return nullptr; }
+}
+
+inline void deallocate(void* p) noexcept {
+  if(!p)
+    return;
+
+  on_deallocate();
+  std::free(p);
+}
+
+#if defined(__cpp_aligned_new)
+inline void* allocate(std::size_t n, std::align_val_t a) {
+  std::size_t al = static_cast<std::size_t>(a);
+
+  // aligned_alloc wants the size to be a multiple of the alignment.
+  std::size_t m = n ? (n + al - 1) / al * al : al;
+
+  for(;;) {
+    if(void* p = ::aligned_alloc(al, m)) {
+      on_allocate(n);
+      return p;
+    }
+
+    std::new_handler h = std::get_new_handler();
+    if(!h)
+      throw std::bad_alloc();
+    h();
+  }
+}
+
+inline void* allocate(std::size_t n, std::align_val_t a, std::nothrow_t const&) noexcept {
+  try { return allocate(n, a); }
+  catch(...) { return nullptr; }
+}
+#endif
+
+} // namespace detail_
+} // namespace alloc_counter
+} // namespace prosto
+
+
+void* operator new(std::size_t n) { return prosto::alloc_counter::detail_::allocate(n); }
+void* operator new[](std::size_t n) { return prosto::alloc_counter::detail_::allocate(n); }
+
+void* operator new(std::size_t n, std::nothrow_t const& t) noexcept {
+  return prosto::alloc_counter::detail_::allocate(n, t);
+}
+void* operator new[](std::size_t n, std::nothrow_t const& t) noexcept {
+  return prosto::alloc_counter::detail_::allocate(n, t);
+}
+
+void operator delete(void* p) noexcept { prosto::alloc_counter::detail_::deallocate(p); }
+void operator delete[](void* p) noexcept { prosto::alloc_counter::detail_::deallocate(p); }
+
+void operator delete(void* p, std::nothrow_t const&) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+void operator delete[](void* p, std::nothrow_t const&) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* p, std::size_t) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+#endif
+
+#if defined(__cpp_aligned_new)
+void* operator new(std::size_t n, std::align_val_t a) {
+  return prosto::alloc_counter::detail_::allocate(n, a);
+}
+void* operator new[](std::size_t n, std::align_val_t a) {
+  return prosto::alloc_counter::detail_::allocate(n, a);
+}
+
+void* operator new(std::size_t n, std::align_val_t a, std::nothrow_t const& t) noexcept {
+  return prosto::alloc_counter::detail_::allocate(n, a, t);
+}
+void* operator new[](std::size_t n, std::align_val_t a, std::nothrow_t const& t) noexcept {
+  return prosto::alloc_counter::detail_::allocate(n, a, t);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+void operator delete[](void* p, std::align_val_t) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+
+void operator delete(void* p, std::align_val_t, std::nothrow_t const&) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+void operator delete[](void* p, std::align_val_t, std::nothrow_t const&) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+
+#  if defined(__cpp_sized_deallocation)
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+  prosto::alloc_counter::detail_::deallocate(p);
+}
+#  endif
+#endif
+
+#endif // PROSTO_ALLOC_COUNTER_DEFINE_HOOKS
@@ -0,0 +1,369 @@
+/* ************************************************************************* *\
+ * This file is part of prosto-lib.                                          *
+ *                                                                           *
+ * This library is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU Lesser General Public License as published by  *
+ * the Free Software Foundation; either version 2.1 of the License.          *
+ *                                                                           *
+ * This library is distributed in the hope that it will be useful, but       *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser   *
+ * General Public License for more details.                                  *
+ *                                                                           *
+ * You should have received a copy of the GNU Lesser General Public License  *
+ * along with this library (see the file LICENCE); If not, see               *
+ * <http://www.gnu.org/licenses/old-licenses/lgpl-2.1.en.html>.              *
+\* ************************************************************************* */
+
+/*!
+ * \file   reporter.hpp
+ * \author michail peterlis
+ * \brief  Rate limited, deduplicating printer for exceptions.
+ * ************************************************************************* */
+
+
+#ifndef PROSTO_EXCEPTION_REPORTER_HPP
+#define PROSTO_EXCEPTION_REPORTER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <typeinfo>
+
+#include "exception.hpp"
+#include "common_print.hpp"
+
+
+namespace prosto {
+
+//! \example reporter_test.cpp
+
+/*! \brief Prints exceptions, but only the first ones of a kind.
+ *
+ * Every reported exception is fingerprinted by its type, code, throw site and
+ * the shape of its nested chain. Each fingerprint owns a token bucket holding
+ * \a burst tokens. As long as there are tokens left, the exception is printed
+ * in full (preceded by its fingerprint). Afterwards it is only counted, and a
+ * summary line like
+ * \code
+ * fingerprint	:	0x1A2B3C4D5E6F7081 suppressed 4711 times in 10.0 seconds
+ * \endcode
+ * is printed once per \a interval, when the bucket is refilled.
+ *
+ * <h2>Short usage</h2>
+ * \code
+ * prosto::reporter rep(std::cerr, std::chrono::seconds(10));
+ * // ...
+ *
+ * catch(std::exception const& e) {
+ *   rep.report(e);
+ * }
+ * \endcode
+ *
+ * Summaries are emitted by flush(). report() calls it by itself once the
+ * interval is over; the clock is only read on a full print, on the first
+ * suppression of an interval, on power-of-two and on every 1024th suppression
+ * of a fingerprint. So a summary is at most one interval (or 1024 reports)
+ * late. A reporter which falls silent should be flushed from some timer.
+ *
+ * \note
+ * The throw site (filename and linenumber) is only known in (pseudo) debug
+ * mode. Otherwise the message is hashed instead.
+ *
+ * \note
+ * Inspecting a nested exception requires rethrowing it, so fingerprinting a
+ * nested chain costs one rethrow per level. Exceptions without nested ones
+ * are fingerprinted without any throw and without any allocation.
+ *
+ * \note
+ * The table has a fixed capacity. A fingerprint which was not reported for a
+ * whole interval is forgotten by flush(), so its slot can be taken by a new
+ * one. A fingerprint is looked up in at most 16 slots. If none of them is free,
+ * the exception goes into a single overflow bucket shared by all of those,
+ * which is rate limited the same way and summarized as
+ * \code
+ * unclassified	:	suppressed 4711 times in 10.0 seconds
+ * \endcode
+ *
+ * \exception all Writing to the stream might throw, depending on the stream.
+ */
+class reporter {
+public:
+
+  using clock = std::chrono::steady_clock;
+
+
+  /*! \brief Creates a reporter writing to \a os.
+   *
+   * \param os       The stream to write to. It has to outlive the reporter.
+   * \param interval Time between two summaries; also the refill period of the buckets.
+   * \param burst    Full prints per fingerprint and interval.
+   * \param capacity Number of distinct fingerprints; rounded up to a power of two.
+   */
+  explicit reporter(std::ostream& os
+                   ,clock::duration interval = std::chrono::seconds(10)
+                   ,unsigned int burst = 1
+                   ,std::size_t capacity = 1024)
+    : os_(os)
+    , interval_(interval.count())
+    , burst_(burst)
+    , mask_(round_up(capacity) - 1)
+    , slots_(new slot[mask_ + 1])
+    , last_flush_(now()) {
+    std::int64_t t = last_flush_.load(std::memory_order_relaxed);
+
+    for(std::size_t i = 0; i <= mask_; i++) {
+      slots_[i].tokens.store(burst_, std::memory_order_relaxed);
+      slots_[i].since.store(t, std::memory_order_relaxed);
+    }
+
+    overflow_.tokens.store(burst_, std::memory_order_relaxed);
+    overflow_.since.store(t, std::memory_order_relaxed);
+  }
+
+  reporter(reporter const&) = delete;
+  reporter& operator=(reporter const&) = delete;
+
+
+  /*! \brief Reports an exception.
+   *
+   * Returns true if the exception was printed, false if it was suppressed.
+   * A suppressed exception costs the fingerprint and an atomic decrement.
+   */
+  bool report(std::exception const& e) {
+    std::uint64_t h = fingerprint(e);
+    slot* s = find(h);
+
+    std::int64_t left = s->tokens.fetch_sub(1, std::memory_order_relaxed) - 1;
+
+    if(left >= 0) {
+      print(h, e);
+      maybe_flush();
+      return true;
+    }
+
+    // checks the clock on the first suppression, then with decreasing frequency.
+    std::int64_t n = -left;
+    if((n & (n - 1)) == 0 || (n & 1023) == 0)
+      maybe_flush();
+
+    return false;
+  }
+
+  /*! \brief Refills all buckets and prints a summary for each suppressed fingerprint.
+   *
+   * Thread safe; concurrent reports are either counted for the old or for the
+   * new interval, never lost.
+   */
+  void flush() {
+    std::int64_t t = now();
+    last_flush_.store(t, std::memory_order_relaxed);
+
+    for(std::size_t i = 0; i <= mask_; i++) {
+      slot& s = slots_[i];
+      std::uint64_t h = s.key.load(std::memory_order_acquire);
+      if(h == 0 || h == tombstone())
+        continue;
+
+      std::int64_t left = s.tokens.exchange(burst_, std::memory_order_relaxed);
+      std::int64_t since = s.since.exchange(t, std::memory_order_relaxed);
+
+      if(left < 0)
+        summary(h, -left, clock::duration(t - since));
+
+      // idle for a whole interval; leave a tombstone, so the chains behind stay intact.
+      else if(left == burst_ && t - since >= interval_)
+        s.key.compare_exchange_strong(h, tombstone(), std::memory_order_acq_rel);
+    }
+
+    std::int64_t left = overflow_.tokens.exchange(burst_, std::memory_order_relaxed);
+    std::int64_t since = overflow_.since.exchange(t, std::memory_order_relaxed);
+
+    if(left < 0)
+      summary(0, -left, clock::duration(t - since));
+  }
+
+  /*! \brief Returns the fingerprint of an exception.
+   *
+   * The fingerprint is a 64 bit FNV-1a hash over type, code, throw site (or
+   * message) of the exception and all of its nested exceptions. It is never 0
+   * and never ~0, which mark free slots.
+   */
+  static std::uint64_t fingerprint(std::exception const& e) {
+    std::uint64_t h = 0xCBF29CE484222325ull;
+    fingerprint(e, h);
+    return h && h != tombstone() ? h : 1;
+  }
+
+
+private:
+
+  struct slot {
+    slot() : key(0), tokens(0), since(0) {}
+
+    std::atomic<std::uint64_t> key;
+    std::atomic<std::int64_t>  tokens;
+    std::atomic<std::int64_t>  since;
+  };
+
+
+  static std::size_t round_up(std::size_t n) {
+    std::size_t p = 1;
+    while(p < n)
+      p <<= 1;
+    return p;
+  }
+
+  //! Key of a slot whose fingerprint was forgotten.
+  static constexpr std::uint64_t tombstone() { return ~0ull; }
+
+  static std::int64_t now() {
+    return clock::now().time_since_epoch().count();
+  }
+
+
+  static void mix(std::uint64_t& h, void const* data, std::size_t n) {
+    unsigned char const* p = static_cast<unsigned char const*>(data);
+    for(std::size_t i = 0; i < n; i++) {
+      h ^= p[i];
+      h *= 0x100000001B3ull;
+    }
+  }
+
+  template<typename T>
+  static void mix(std::uint64_t& h, T const& v) {
+    mix(h, &v, sizeof(v));
+  }
+
+  static void mix(std::uint64_t& h, char const* s) {
+    mix(h, s, std::strlen(s));
+  }
+
+  static void fingerprint(std::exception const& e, std::uint64_t& h) {
+    mix(h, typeid(e).hash_code());
+
+    if(auto eh = exception::info<exception::code>(e))
+      mix(h, *eh);
+
+#ifdef PROSTO_PSEUDO_DEBUG
+    auto file = exception::info<exception::filename>(e);
+    auto line = exception::info<exception::linenumber>(e);
+    if(file && line) {
+      mix(h, *file);
+      mix(h, *line);
+    }
+    else
+#endif
+    if(auto eh = exception::info<exception::message>(e))
+      mix(h, eh->data(), eh->size());
+    else
+      mix(h, e.what());
+
+    auto n = dynamic_cast<std::nested_exception const*>(&e);
+    if(!n || !n->nested_ptr())
+      return;
+
+    try { std::rethrow_exception(n->nested_ptr()); }
+    catch(std::exception const& c) {
+      mix(h, '>');
+      fingerprint(c, h);
+    }
+    catch(...) {
+      mix(h, '?');
+    }
+  }
+
+
+  /*! \brief Finds or claims the slot of \a h. Returns the overflow bucket if there is none.
+   *
+   * The chain is searched up to its end (an empty slot) before a free slot is
+   * claimed, preferring the first tombstone on the way.
+   */
+  slot* find(std::uint64_t h) {
+    slot* free = nullptr;
+
+    for(std::size_t i = 0; i < 16 && i <= mask_; i++) {
+      slot& s = slots_[(h + i) & mask_];
+      std::uint64_t k = s.key.load(std::memory_order_acquire);
+
+      if(k == h)
+        return &s;
+
+      if(k == tombstone() && !free)
+        free = &s;
+
+      if(k == 0) {
+        if(!free)
+          free = &s;
+        break;
+      }
+    }
+
+    if(!free)
+      return &overflow_;
+
+    std::uint64_t k = free->key.load(std::memory_order_acquire);
+    if((k == 0 || k == tombstone())
+       && free->key.compare_exchange_strong(k, h, std::memory_order_acq_rel)) {
+      free->since.store(now(), std::memory_order_relaxed);
+      return free;
+    }
+
+    if(k == h)
+      return free;
+
+    // someone else took the slot, look again.
+    return find(h);
+  }
+
+  void maybe_flush() {
+    std::int64_t last = last_flush_.load(std::memory_order_relaxed);
+    if(now() - last < interval_)
+      return;
+
+    // only one thread wins the interval.
+    if(last_flush_.compare_exchange_strong(last, now(), std::memory_order_relaxed))
+      flush();
+  }
+
+
+  void print(std::uint64_t h, std::exception const& e) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    os_ << "fingerprint\t:\t0x" << std::hex << std::uppercase << h
+        << std::dec << std::nouppercase << "\n";
+    os_ << e;
+  }
+
+  //! Prints the summary of fingerprint \a h, or of the overflow bucket if \a h is 0.
+  void summary(std::uint64_t h, std::int64_t n, clock::duration d) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(h)
+      os_ << "fingerprint\t:\t0x" << std::hex << std::uppercase << h
+          << std::dec << std::nouppercase << " ";
+    else
+      os_ << "unclassified\t:\t";
+
+    os_ << "suppressed " << n << " times in "
+        << std::chrono::duration<double>(d).count() << " seconds\n";
+  }
+
+
+  std::ostream& os_;
+  std::mutex mutex_;
+
+  std::int64_t const interval_;
+  std::int64_t const burst_;
+  std::size_t const mask_;
+  std::unique_ptr<slot[]> slots_;
+  slot overflow_;
+  std::atomic<std::int64_t> last_flush_;
+};
+
+
+}  // namespace prosto
+
+#endif // PROSTO_EXCEPTION_REPORTER_HPP